@@ -0,0 +1,77 @@
+#!/usr/bin/env node
+
+// Measures the per-request overhead of the gatekeeper middleware by calling
+// it directly with stub requests. No master needs to be running; accounting
+// messages are simply dropped by zmq.
+
+var Smockron = require('../lib/smockron');
+
+var REQUESTS = parseInt(process.argv[2], 10) || 200000,
+    IDENTIFIERS = parseInt(process.argv[3], 10) || 1000,
+    BATCH_SIZE = parseInt(process.argv[4], 10) || 0;
+
+var gk = new Smockron.Gatekeeper({
+    domain: "default",
+    server: "localhost",
+    identifierCB: Smockron.Gatekeeper.REMOTE_ADDR,
+    maxParked: REQUESTS,
+    maxParkedPerIdentifier: REQUESTS,
+    accountingBatchSize: BATCH_SIZE
+});
+
+var requests = [];
+for (var i = 0; i < IDENTIFIERS; i++)
+  requests.push({ ip: "10.0." + (i >> 8) + "." + (i & 255) });
+
+var res = { send: function() {} };
+var released, rejected;
+var middleware = gk.middleware(function() { rejected++ });
+
+// Times the middleware calls, then waits (up to a few seconds) for every
+// request to be either released or rejected, and checks how many of them
+// were released.
+function run(name, setup, expectReleased, done) {
+  setup(Date.now());
+
+  released = rejected = 0;
+  var next = function() { released++ };
+
+  var start = process.hrtime();
+  for (var i = 0; i < REQUESTS; i++)
+    middleware(requests[i % IDENTIFIERS], res, next);
+  var elapsed = process.hrtime(start);
+
+  var ns = elapsed[0] * 1e9 + elapsed[1];
+  console.log(name + ": " + (ns / REQUESTS).toFixed(0) + " ns/request (" +
+      REQUESTS + " requests, " + IDENTIFIERS + " identifiers, batch size " +
+      BATCH_SIZE + ")");
+
+  gk.client.flushAccounting();
+
+  var deadline = Date.now() + 5000;
+  (function wait() {
+    if (released + rejected < REQUESTS && Date.now() < deadline)
+      return setTimeout(wait, 10);
+    console.log("  " + released + " released, " + rejected + " rejected");
+    if (released != expectReleased) {
+      console.error("  expected " + expectReleased + " released");
+      process.exit(1);
+    }
+    done();
+  })();
+}
+
+function delayAll(offset) {
+  return function(now) {
+    for (var i = 0; i < IDENTIFIERS; i++)
+      gk._delayUntil({ identifier: requests[i].ip, ts: now + offset });
+  };
+}
+
+run("accepted", function() {}, REQUESTS, function() {
+  run("delayed", delayAll(50), REQUESTS, function() {
+    run("rejected", delayAll(60000), 0, function() {
+      process.exit(0);
+    });
+  });
+});
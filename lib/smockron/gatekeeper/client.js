@@ -8,6 +8,12 @@ function Client(opts) {
   this._domain = opts.domain;
   this.server = this._parseConnectionString(opts.server);
   this.socket = {};
+
+  this.batchSize = opts.batchSize || 0;
+  this.batchInterval = opts.batchInterval || 10;
+  this._batch = [];
+  this._batchTimer = null;
+  this._flushAccounting = this.flushAccounting.bind(this);
 };
 
 util.inherits(Client, events.EventEmitter);
@@ -91,4 +97,43 @@ Client.prototype.sendAccounting = function(opts) {
   this.socket.accounting.send(frames);
 };
 
+// Queue an accounting record to be sent as part of a BATCH message, which
+// carries five frames (status, identifier, rcvTS, delayTS, logInfo) per
+// record. The batch goes out when it fills up or batchInterval ms after the
+// first record was queued, whichever comes first. Batching is only enabled
+// when batchSize is set, since masters older than BATCH support will
+// misread it; otherwise each record is sent on its own.
+Client.prototype.queueAccounting = function(opts) {
+  if (!this.batchSize)
+    return this.sendAccounting(opts);
+
+  this._batch.push(
+    opts.status,
+    opts.identifier,
+    opts.rcvTS,
+    opts.delayTS !== undefined ? opts.delayTS : "",
+    opts.logInfo !== undefined ? opts.logInfo : ""
+  );
+  if (this._batch.length >= this.batchSize * 5) {
+    this.flushAccounting();
+  } else if (this._batchTimer === null) {
+    this._batchTimer = setTimeout(this._flushAccounting, this.batchInterval);
+  }
+};
+
+Client.prototype.flushAccounting = function() {
+  if (this._batchTimer !== null) {
+    clearTimeout(this._batchTimer);
+    this._batchTimer = null;
+  }
+  if (this._batch.length == 0)
+    return;
+  var frames = [
+    this._domain + "\0",
+    "BATCH"
+  ].concat(this._batch);
+  this._batch = [];
+  this.socket.accounting.send(frames);
+};
+
 module.exports = Client;
@@ -1,27 +1,56 @@
 var Client = require('./client');
 
+// Delays are indexed by the second they expire in, so that cleanup only
+// has to look at buckets that have already passed.
+var EXPIRY_GRANULARITY = 1000;
+
 function Gatekeeper(opts) {
   this.identifierCB = opts.identifierCB;
 
+  this.maxDelay = opts.maxDelay !== undefined ? opts.maxDelay : 5000;
+  this.maxParked = opts.maxParked !== undefined ? opts.maxParked : 10000;
+  this.maxParkedPerIdentifier = opts.maxParkedPerIdentifier !== undefined ? opts.maxParkedPerIdentifier : 100;
+  this.releaseResolution = opts.releaseResolution || 10;
+
   this.client = new Client({
     domain: opts.domain,
-    server: opts.server
+    server: opts.server,
+    batchSize: opts.accountingBatchSize,
+    batchInterval: opts.accountingBatchInterval
   });
 
   this.delayed = {};
+  this._expiry = {};
+  this._expiryTick = Math.floor((new Date()).getTime() / EXPIRY_GRANULARITY);
+
+  this._parked = {};
+  this._parkedCount = 0;
+  this._parkedByIdentifier = {};
+  this._releaseTick = 0;
+  this._releaseTimer = null;
+  this._timerTick = 0;
+  this._release = this._release.bind(this);
 
   this.client.on('control', this._onControl.bind(this));
   this.client.connect();
 
-  setInterval(this._cleanup.bind(this), 1000).unref();
+  setInterval(this._cleanup.bind(this), EXPIRY_GRANULARITY).unref();
 };
 
 Gatekeeper.prototype._cleanup = function() {
   var now = (new Date()).getTime();
+  var nowTick = Math.floor(now / EXPIRY_GRANULARITY);
 
-  for (var key in this.delayed) {
-    if (this.delayed[key] < now)
-      delete this.delayed[key];
+  for (; this._expiryTick < nowTick; this._expiryTick++) {
+    var bucket = this._expiry[this._expiryTick];
+    if (bucket === undefined)
+      continue;
+    delete this._expiry[this._expiryTick];
+    for (var i = 0; i < bucket.length; i++) {
+      // An identifier whose delay was extended also sits in a later bucket.
+      if (this.delayed[bucket[i]] < now)
+        delete this.delayed[bucket[i]];
+    }
   }
 };
 
@@ -39,8 +68,82 @@ Gatekeeper.prototype._onControl = function(msg) {
 };
 
 Gatekeeper.prototype._delayUntil = function(msg) {
-  if (this.delayed[msg.identifier] === undefined || msg.ts > this.delayed[msg.identifier])
-    this.delayed[msg.identifier] = msg.ts;
+  var prev = this.delayed[msg.identifier];
+  if (prev !== undefined && msg.ts <= prev)
+    return;
+
+  this.delayed[msg.identifier] = msg.ts;
+
+  var tick = Math.floor(msg.ts / EXPIRY_GRANULARITY);
+  if (tick < this._expiryTick)
+    tick = this._expiryTick;
+  if (prev === undefined || Math.floor(prev / EXPIRY_GRANULARITY) != tick) {
+    if (this._expiry[tick] === undefined)
+      this._expiry[tick] = [];
+    this._expiry[tick].push(msg.identifier);
+  }
+};
+
+// Park a request until delayTS. Requests are grouped into releaseResolution
+// ms ticks and a single timer, armed for the earliest pending tick, releases
+// every tick that has come due, rather than each request having a timer of
+// its own. Returns false if the global or per-identifier cap on parked
+// requests has been reached.
+Gatekeeper.prototype._park = function(identifier, delayTS, now, next) {
+  var forIdentifier = this._parkedByIdentifier[identifier] || 0;
+  if (this._parkedCount >= this.maxParked || forIdentifier >= this.maxParkedPerIdentifier)
+    return false;
+
+  var tick = Math.ceil(delayTS / this.releaseResolution);
+  if (this._parked[tick] === undefined)
+    this._parked[tick] = [];
+  this._parked[tick].push(identifier, next);
+
+  if (this._parkedCount == 0 || tick < this._releaseTick)
+    this._releaseTick = tick;
+  this._parkedCount++;
+  this._parkedByIdentifier[identifier] = forIdentifier + 1;
+
+  this._armRelease(tick);
+  return true;
+};
+
+Gatekeeper.prototype._armRelease = function(tick) {
+  if (this._releaseTimer !== null) {
+    if (this._timerTick <= tick)
+      return;
+    clearTimeout(this._releaseTimer);
+  }
+  this._timerTick = tick;
+  this._releaseTimer = setTimeout(this._release,
+      Math.max(tick * this.releaseResolution - Date.now(), 0));
+};
+
+Gatekeeper.prototype._release = function() {
+  var nowTick = Math.floor(Date.now() / this.releaseResolution);
+  this._releaseTimer = null;
+
+  for (; this._parkedCount > 0 && this._releaseTick <= nowTick; this._releaseTick++) {
+    var bucket = this._parked[this._releaseTick];
+    if (bucket === undefined)
+      continue;
+    delete this._parked[this._releaseTick];
+    this._parkedCount -= bucket.length / 2;
+    for (var i = 0; i < bucket.length; i += 2) {
+      var identifier = bucket[i];
+      if (--this._parkedByIdentifier[identifier] == 0)
+        delete this._parkedByIdentifier[identifier];
+      // Each request continues from its own callback, as it did with one
+      // timer per request, so a throwing handler can't strand the rest.
+      setImmediate(bucket[i + 1]);
+    }
+  }
+
+  if (this._parkedCount > 0) {
+    while (this._parked[this._releaseTick] === undefined)
+      this._releaseTick++;
+    this._armRelease(this._releaseTick);
+  }
 };
 
 Gatekeeper.prototype.middleware = function(rejectCB) {
@@ -52,7 +155,7 @@ Gatekeeper.prototype.middleware = function(rejectCB) {
   }
 
   return function (req, res, next) {
-    var now = (new Date()).getTime();
+    var now = Date.now();
     var identifier = self.identifierCB(req);
     var delayTS = self.delayed[identifier];
     var accounting = {
@@ -61,20 +164,19 @@ Gatekeeper.prototype.middleware = function(rejectCB) {
     };
 
     if (delayTS && delayTS > now) {
-      if (delayTS > now + 5000) {
-        setImmediate(function () { rejectCB(req, res) });
-        accounting.status = 'REJECTED';
-      } else {
-        setTimeout(next, delayTS - now);
+      if (delayTS <= now + self.maxDelay && self._park(identifier, delayTS, now, next)) {
         accounting.status = 'DELAYED';
         accounting.delayTS = delayTS;
+      } else {
+        setImmediate(function () { rejectCB(req, res) });
+        accounting.status = 'REJECTED';
       }
+      self.client.queueAccounting(accounting);
     } else {
       accounting.status = 'ACCEPTED';
+      self.client.queueAccounting(accounting);
       setImmediate(next);
     }
-
-    self.client.sendAccounting(accounting);
   };
 };
 
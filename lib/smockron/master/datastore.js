@@ -54,7 +54,10 @@ DataStore.prototype.logAccess = function(opts) {
         return when.reject(err);
       }
     })
-  }).catch(console.warn);
+  }).catch(function (err) {
+    console.warn(err);
+    return when.reject(err);
+  });
 };
 
 DataStore.prototype.getNext = function(opts) {
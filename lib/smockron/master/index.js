@@ -7,7 +7,7 @@ function Master(config) {
   this.server = new Server(this.config.server);
   this.dataStore = new DataStore(this.config.datastore);
   if (this.config.stats) {
-    this.stats = new Stats(this.config.stats);
+    this.stats = new Stats(this.configureStats(this.config.stats));
   }
   this.domains = this.configureDomains(this.config.domains);
   this.server.on('accounting', this._onAccounting.bind(this));
@@ -75,6 +75,15 @@ Master.prototype.configureDomains = function(domains) {
   return ret;
 };
 
+Master.prototype.configureStats = function(stats) {
+  var ret = {};
+  for (var key in stats)
+    ret[key] = stats[key];
+  if (stats.flushInterval !== undefined)
+    ret.flushInterval = this.parseInterval(stats.flushInterval);
+  return ret;
+};
+
 Master.prototype.listen = function() {
   this.server.listen();
 };
@@ -86,9 +95,14 @@ Master.prototype._onAccounting = function(msg) {
 
   if (!domain) {
     console.warn("Received accounting message for unknown domain", msg.domain);
+    if (this.stats)
+      this.stats.logUnknownDomain();
     return;
   }
 
+  if (this.stats)
+    this.stats.logAccess(msg, now);
+
   if (msg.status == 'REJECTED') {
     return; // Do nothing, for now.
   } else if (msg.status == 'ACCEPTED') {
@@ -98,6 +112,7 @@ Master.prototype._onAccounting = function(msg) {
   }
 
   var self = this;
+  var redisStart = (new Date()).getTime();
 
   self.dataStore.logAccess({
     domain: msg.domain,
@@ -107,6 +122,8 @@ Master.prototype._onAccounting = function(msg) {
     burst: domain.burst,
     now: now
   }).then(function (delayUntil) {
+    if (self.stats)
+      self.stats.logRedisLatency((new Date()).getTime() - redisStart);
     if (delayUntil > now) {
       self.server.sendControl({
         domain: msg.domain,
@@ -115,12 +132,12 @@ Master.prototype._onAccounting = function(msg) {
         args: [ delayUntil ]
       });
     }
+  }, function () {
+    if (self.stats) {
+      self.stats.logRedisLatency((new Date()).getTime() - redisStart);
+      self.stats.logRedisError();
+    }
   });
-
-  if (self.stats) {
-    self.stats.logAccess(msg);
-  }
-
 };
 
 Master.prototype.shouldDelay = function(domainName, identifier, domain, now) {
@@ -48,8 +48,14 @@ Server.prototype.listen = function() {
 
 Server.prototype._onAccounting = function() {
   try {
-    accountingMsg = this._parseAccounting(arguments);
-    this.emit('accounting', accountingMsg);
+    if (arguments.length > 1 && arguments[1].toString() == 'BATCH') {
+      var batch = this._parseBatch(arguments);
+      for (var i = 0; i < batch.length; i++)
+        this.emit('accounting', batch[i]);
+    } else {
+      accountingMsg = this._parseAccounting(arguments);
+      this.emit('accounting', accountingMsg);
+    }
   } catch (e) {
     console.warn("Accounting error", e);
   }
@@ -78,6 +84,31 @@ Server.prototype._parseAccounting = function(data) {
   return ret;
 };
 
+Server.prototype._parseBatch = function(data) {
+  if ((data.length - 2) % 5 != 0) {
+    throw("Malformed accounting batch");
+  }
+
+  var domain = data[0].toString().replace(/\0$/, '');
+  var ret = [];
+
+  for (var i = 2; i < data.length; i += 5) {
+    var msg = {
+      domain: domain,
+      status: data[i].toString(),
+      identifier: data[i + 1].toString(),
+      rcvTS: parseFloat(data[i + 2].toString())
+    };
+    if (data[i + 3].length)
+      msg.delayTS = parseFloat(data[i + 3].toString());
+    if (data[i + 4].length)
+      msg.logInfo = parseFloat(data[i + 4].toString());
+    ret.push(msg);
+  }
+
+  return ret;
+};
+
 Server.prototype.sendControl = function(opts) {
   var frames = [
     opts.domain + "\0",
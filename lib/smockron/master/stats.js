@@ -1,16 +1,320 @@
-var statsd = require('node-statsd').StatsD;
+var dgram = require('dgram'),
+    http = require('http');
+
+// HDR-style histogram. Values below SUB_BUCKETS ms get a 1ms bucket each;
+// above that, every power of two is split into SUB_BUCKETS linear
+// sub-buckets, so a bucket is never wider than 1/SUB_BUCKETS of its value.
+var SUB_BUCKETS = 16,
+    SUB_BUCKET_BITS = 4;
+
+function Histogram() {
+  this.count = 0;
+  this.sum = 0;
+  this.max = 0;
+  this.buckets = [];
+};
+
+Histogram.prototype._bucketFor = function(value) {
+  if (value < SUB_BUCKETS)
+    return Math.floor(value);
+  var exp = Math.floor(Math.log(value) / Math.LN2);
+  // Correct for rounding in the log at exact powers of two.
+  if (Math.pow(2, exp + 1) <= value)
+    exp++;
+  else if (Math.pow(2, exp) > value)
+    exp--;
+  var shift = exp - SUB_BUCKET_BITS;
+  var sub = Math.floor(value / Math.pow(2, shift)) - SUB_BUCKETS;
+  return SUB_BUCKETS * (shift + 1) + sub;
+};
+
+// Midpoint of a bucket's [lower, upper) range.
+Histogram.prototype._bucketValue = function(bucket) {
+  if (bucket < SUB_BUCKETS)
+    return bucket + 0.5;
+  var shift = Math.floor(bucket / SUB_BUCKETS) - 1;
+  var sub = bucket % SUB_BUCKETS;
+  return (SUB_BUCKETS + sub + 0.5) * Math.pow(2, shift);
+};
+
+Histogram.prototype.add = function(value) {
+  if (!(value >= 0))
+    value = 0;
+  var bucket = this._bucketFor(value);
+  this.buckets[bucket] = (this.buckets[bucket] || 0) + 1;
+  this.count++;
+  this.sum += value;
+  if (value > this.max)
+    this.max = value;
+};
+
+// Midpoint of the bucket containing the given quantile, capped at the
+// largest value actually seen.
+Histogram.prototype.quantile = function(q) {
+  if (this.count == 0)
+    return 0;
+  var rank = Math.ceil(q * this.count), seen = 0;
+  for (var i = 0; i < this.buckets.length; i++) {
+    seen += this.buckets[i] || 0;
+    if (seen >= rank)
+      return Math.min(this._bucketValue(i), this.max);
+  }
+  return this.max;
+};
+
+Histogram.prototype.summary = function() {
+  return {
+    count: this.count,
+    mean: this.count ? this.sum / this.count : 0,
+    max: this.max,
+    p50: this.quantile(0.5),
+    p95: this.quantile(0.95),
+    p99: this.quantile(0.99)
+  };
+};
+
+// Stream-Summary structure for space-saving top-k counting. Counters hang
+// off a list of count buckets kept in ascending order, so both incrementing
+// a counter and finding the least-counted one to evict are O(1).
+function StreamSummary(capacity) {
+  this.capacity = capacity;
+  this.size = 0;
+  this.nodes = {};
+  this.minBucket = null;
+};
+
+StreamSummary.prototype._detach = function(node) {
+  var bucket = node.bucket;
+  if (node.prev)
+    node.prev.next = node.next;
+  else
+    bucket.head = node.next;
+  if (node.next)
+    node.next.prev = node.prev;
+
+  if (bucket.head === null) {
+    if (bucket.prev)
+      bucket.prev.next = bucket.next;
+    else
+      this.minBucket = bucket.next;
+    if (bucket.next)
+      bucket.next.prev = bucket.prev;
+  }
+};
+
+// Attach node to the bucket for count, which must come right after `after`
+// (or at the head of the list if after is null).
+StreamSummary.prototype._attach = function(node, count, after) {
+  var bucket = after ? after.next : this.minBucket;
+  if (bucket === null || bucket.count != count) {
+    bucket = { count: count, head: null, prev: after, next: bucket };
+    if (bucket.next)
+      bucket.next.prev = bucket;
+    if (after)
+      after.next = bucket;
+    else
+      this.minBucket = bucket;
+  }
+  node.bucket = bucket;
+  node.prev = null;
+  node.next = bucket.head;
+  if (bucket.head)
+    bucket.head.prev = node;
+  bucket.head = node;
+};
+
+StreamSummary.prototype._increment = function(node) {
+  var bucket = node.bucket;
+  this._detach(node);
+  // If the old bucket was emptied it is unlinked, but its prev pointer
+  // still marks where the next count belongs.
+  this._attach(node, bucket.count + 1, bucket.head === null ? bucket.prev : bucket);
+};
+
+StreamSummary.prototype.add = function(key) {
+  var node = this.nodes[key];
+  if (node !== undefined) {
+    this._increment(node);
+  } else if (this.size < this.capacity) {
+    node = this.nodes[key] = { key: key };
+    this.size++;
+    this._attach(node, 1, null);
+  } else {
+    // Evict the least-counted key; the newcomer inherits its count.
+    node = this.minBucket.head;
+    delete this.nodes[node.key];
+    node.key = key;
+    this.nodes[key] = node;
+    this._increment(node);
+  }
+};
+
+StreamSummary.prototype.top = function(k) {
+  var ret = [];
+  for (var bucket = this.minBucket; bucket; bucket = bucket.next) {
+    for (var node = bucket.head; node; node = node.next)
+      ret.push({ key: node.key, count: bucket.count });
+  }
+  return ret.reverse().slice(0, k);
+};
 
 function Stats(opts) {
-  this.statsd = new statsd(opts);
+  this.host = opts.host;
+  this.port = opts.port || 8125;
+  this.prefix = opts.prefix || '';
+  this.flushInterval = opts.flushInterval || 10000;
+  this.maxPacketSize = opts.maxPacketSize || 1432;
+  this.topIdentifiers = opts.topIdentifiers || 0;
+  this.identifierCapacity = this.topIdentifiers * 10;
+
+  this.snapshot = {};
+  // Every histogram name seen so far. Histograms are sent as gauges, which
+  // statsd holds at their last value, so a histogram with no samples in an
+  // interval has to be flushed as zeros rather than left out.
+  this.histogramNames = {};
+  this._reset();
+
+  if (this.host) {
+    this.socket = dgram.createSocket('udp4');
+    this.socket.unref();
+  }
+  if (opts.listen)
+    this._listen(opts.listen);
+
+  setInterval(this.flush.bind(this), this.flushInterval).unref();
+};
+
+Stats.prototype._reset = function() {
+  this.counters = {};
+  this.histograms = {};
+  this.identifiers = new StreamSummary(this.identifierCapacity);
+  this.startTS = (new Date()).getTime();
+};
+
+Stats.prototype._increment = function(name, value) {
+  this.counters[name] = (this.counters[name] || 0) + (value === undefined ? 1 : value);
 };
 
-Stats.prototype.logAccess = function(msg) {
-  this.statsd.increment('request.status.' + msg.status);
-  this.statsd.increment('request.total');
+Stats.prototype._histogram = function(name, value) {
+  var histogram = this.histograms[name];
+  if (histogram === undefined) {
+    histogram = this.histograms[name] = new Histogram();
+    this.histogramNames[name] = true;
+  }
+  histogram.add(value);
+};
+
+Stats.prototype._topIdentifiers = function() {
+  return this.identifiers.top(this.topIdentifiers).map(function (top) {
+    var parts = top.key.split("\0");
+    return { domain: parts[0], identifier: parts[1], count: top.count };
+  });
+};
+
+Stats.prototype.logAccess = function(msg, now) {
+  var domain = 'domain.' + _sanitize(msg.domain);
+
+  this._increment('request.status.' + msg.status);
+  this._increment('request.total');
+  this._increment(domain + '.status.' + msg.status);
+  this._increment(domain + '.total');
+
   if (msg.status == 'DELAYED') {
     var delayedBy = msg.delayTS - msg.rcvTS;
-    this.statsd.timing('request.delayed_by', delayedBy);
+    this._histogram('request.delayed_by', delayedBy);
+    this._histogram(domain + '.delayed_by', delayedBy);
+  }
+
+  if (now !== undefined)
+    this._histogram('master.lag', now - msg.rcvTS);
+
+  if (this.topIdentifiers)
+    this.identifiers.add(msg.domain + "\0" + msg.identifier);
+};
+
+Stats.prototype.logUnknownDomain = function() {
+  this._increment('request.unknown_domain');
+};
+
+Stats.prototype.logRedisLatency = function(latency) {
+  this._histogram('master.redis_latency', latency);
+};
+
+Stats.prototype.logRedisError = function() {
+  this._increment('master.redis_errors');
+};
+
+Stats.prototype.flush = function() {
+  var now = (new Date()).getTime();
+  var snapshot = {
+    startTS: this.startTS,
+    endTS: now,
+    counters: this.counters,
+    histograms: {}
+  };
+  for (var name in this.histogramNames) {
+    var histogram = this.histograms[name] || new Histogram();
+    snapshot.histograms[name] = histogram.summary();
+  }
+  if (this.topIdentifiers)
+    snapshot.topIdentifiers = this._topIdentifiers();
+
+  this._reset();
+  this.snapshot = snapshot;
+
+  if (this.socket)
+    this._send(snapshot);
+};
+
+Stats.prototype._send = function(snapshot) {
+  var lines = [], name, field;
+
+  for (name in snapshot.counters)
+    lines.push(this.prefix + name + ':' + snapshot.counters[name] + '|c');
+
+  for (name in snapshot.histograms) {
+    var summary = snapshot.histograms[name];
+    for (field in summary)
+      lines.push(this.prefix + name + '.' + field + ':' + Math.round(summary[field]) + '|g');
+  }
+
+  // Pack as many newline-separated metrics into each datagram as will fit.
+  var packet = '';
+  for (var i = 0; i < lines.length; i++) {
+    if (packet.length && packet.length + 1 + lines[i].length > this.maxPacketSize) {
+      this._sendPacket(packet);
+      packet = '';
+    }
+    packet += (packet.length ? "\n" : '') + lines[i];
   }
+  if (packet.length)
+    this._sendPacket(packet);
+};
+
+Stats.prototype._sendPacket = function(packet) {
+  var buf = new Buffer(packet);
+  this.socket.send(buf, 0, buf.length, this.port, this.host, function (err) {
+    if (err)
+      console.warn("Stats send error", err);
+  });
 };
 
+Stats.prototype._listen = function(listen) {
+  var self = this;
+  var m = String(listen).match(/^(?:(.*):)?(\d+)$/);
+  if (!m)
+    throw "Invalid stats listen address '" + listen + "'";
+
+  this.httpServer = http.createServer(function (req, res) {
+    res.writeHead(200, { 'Content-Type': 'application/json' });
+    res.end(JSON.stringify(self.snapshot) + "\n");
+  });
+  this.httpServer.listen(parseInt(m[2], 10), m[1] || '127.0.0.1');
+  this.httpServer.unref();
+};
+
+function _sanitize(name) {
+  return String(name).replace(/[^A-Za-z0-9_\-]/g, '_');
+}
+
 module.exports = Stats;